@@ -0,0 +1,441 @@
+#include "catalog.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QHash>
+#include <QVector>
+#include <QStringList>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QtConcurrentMap>
+
+#include <algorithm>
+
+/*
+ * catalog layout, little endian
+ *
+ * header      64 bytes: magic, count, offsets of records, strings and indexes
+ * records     72 bytes each: path, model, package, version (string offsets),
+ *             build date (julian day, 0 when unknown), reserved, size,
+ *             mtime, checksum (32 bytes, zero when not an image)
+ * strings     utf-8, zero terminated, offset 0 is the empty string
+ * indexes     record numbers by (model, version), (package, version), path
+ */
+const char CATALOG_MAGIC[8] = { 'M', 'K', 'C', 'A', 'T', 'L', 'G', '1' };
+const int CATALOG_HEADER_SIZE = 64;
+const int CATALOG_RECORD_SIZE = 72;
+
+/* read the header of one changed file, called from the thread pool */
+class HeaderScan {
+public:
+    typedef CatalogRecord result_type;
+
+    HeaderScan(const QString &folder, Catalog::HeaderReader reader)
+        : m_folder(folder), m_reader(reader) {}
+
+    CatalogRecord operator()(const QString &path) const {
+        QFileInfo info(path);
+        qint64 size = info.size();
+        qint64 mtime = info.lastModified().toMSecsSinceEpoch();
+
+        CatalogRecord record;
+        if(!m_reader(path, record))
+            record = CatalogRecord();
+
+        record.path = QDir(m_folder).relativeFilePath(path);
+        record.size = size;
+        record.mtime = mtime;
+        return record;
+    }
+
+private:
+    QString m_folder;
+    Catalog::HeaderReader m_reader;
+};
+
+Catalog::Catalog()
+    : m_data(0), m_size(0), m_count(0),
+      m_recordOffset(0), m_stringOffset(0), m_stringSize(0),
+      m_byModelOffset(0), m_byPackageOffset(0), m_byPathOffset(0) {
+}
+
+Catalog::~Catalog() {
+    close();
+}
+
+bool Catalog::open(const QString &filePath) {
+    close();
+
+    m_file.setFileName(filePath);
+    if(!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    m_size = m_file.size();
+    if(m_size < CATALOG_HEADER_SIZE) {
+        close();
+        return false;
+    }
+
+    m_data = m_file.map(0, m_size);
+    if(!m_data || memcmp(m_data, CATALOG_MAGIC, sizeof(CATALOG_MAGIC)) != 0) {
+        close();
+        return false;
+    }
+
+    quint32 count = qFromLittleEndian<quint32>(m_data + 8);
+    m_recordOffset = qFromLittleEndian<quint32>(m_data + 12);
+    m_stringOffset = qFromLittleEndian<quint32>(m_data + 16);
+    m_stringSize = qFromLittleEndian<quint32>(m_data + 20);
+    m_byModelOffset = qFromLittleEndian<quint32>(m_data + 24);
+    m_byPackageOffset = qFromLittleEndian<quint32>(m_data + 28);
+    m_byPathOffset = qFromLittleEndian<quint32>(m_data + 32);
+
+    quint64 size = m_size;
+    quint64 indexSize = quint64(count) * 4;
+    if(quint64(m_recordOffset) + quint64(count) * CATALOG_RECORD_SIZE > size ||
+            m_stringSize == 0 ||
+            quint64(m_stringOffset) + m_stringSize > size ||
+            m_data[m_stringOffset + m_stringSize - 1] != 0 ||
+            quint64(m_byModelOffset) + indexSize > size ||
+            quint64(m_byPackageOffset) + indexSize > size ||
+            quint64(m_byPathOffset) + indexSize > size) {
+        close();
+        return false;
+    }
+
+    m_count = count;
+    for(int i = 0; i < m_count; i++) {
+        if(indexAt(m_byModelOffset, i) >= count ||
+                indexAt(m_byPackageOffset, i) >= count ||
+                indexAt(m_byPathOffset, i) >= count) {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Catalog::close() {
+    if(m_data)
+        m_file.unmap(const_cast<uchar *>(m_data));
+    m_file.close();
+    m_data = 0;
+    m_size = 0;
+    m_count = 0;
+}
+
+const uchar *Catalog::record(int i) const {
+    return m_data + m_recordOffset + quint64(i) * CATALOG_RECORD_SIZE;
+}
+
+QString Catalog::string(int i, Field field) const {
+    quint32 offset = qFromLittleEndian<quint32>(record(i) + field);
+    if(offset >= m_stringSize)
+        return QString();
+    return QString::fromUtf8(reinterpret_cast<const char *>(m_data + m_stringOffset + offset));
+}
+
+quint32 Catalog::indexAt(quint32 offset, int i) const {
+    return qFromLittleEndian<quint32>(m_data + offset + quint64(i) * 4);
+}
+
+CatalogRecord Catalog::at(int i) const {
+    CatalogRecord ret;
+    if(i < 0 || i >= m_count)
+        return ret;
+
+    const uchar *p = record(i);
+    ret.path = string(i, Path);
+    ret.model = string(i, Model);
+    ret.package = string(i, Package);
+    ret.version = string(i, Version);
+
+    quint32 julianDay = qFromLittleEndian<quint32>(p + 16);
+    if(julianDay)
+        ret.buildDate = QDate::fromJulianDay(julianDay);
+
+    ret.size = qFromLittleEndian<qint64>(p + 24);
+    ret.mtime = qFromLittleEndian<qint64>(p + 32);
+    if(p[40])
+        ret.checksum = QByteArray(reinterpret_cast<const char *>(p + 40), 32);
+    return ret;
+}
+
+/* first position in [first, last) of an index whose field is >= value (> if upper) */
+int Catalog::lowerBound(quint32 offset,
+                        int first,
+                        int last,
+                        Field field,
+                        const QString &value,
+                        bool upper) const {
+    while(first < last) {
+        int mid = first + (last - first) / 2;
+        int cmp = string(indexAt(offset, mid), field).compare(value);
+        if(upper ? cmp <= 0 : cmp < 0)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first;
+}
+
+/* first position in [first, last) whose version is newer than version */
+int Catalog::versionBound(quint32 offset,
+                          int first,
+                          int last,
+                          const QString &version) const {
+    while(first < last) {
+        int mid = first + (last - first) / 2;
+        if(compareVersion(string(indexAt(offset, mid), Version), version) <= 0)
+            first = mid + 1;
+        else
+            last = mid;
+    }
+    return first;
+}
+
+int Catalog::indexOf(const QString &path) const {
+    if(!m_data)
+        return -1;
+
+    int i = lowerBound(m_byPathOffset, 0, m_count, Path, path, false);
+    if(i < m_count && string(indexAt(m_byPathOffset, i), Path) == path)
+        return indexAt(m_byPathOffset, i);
+    return -1;
+}
+
+QList<int> Catalog::find(const QString &model,
+                         const QString &package,
+                         const QString &newerThan) const {
+    QList<int> ret;
+    if(!m_data)
+        return ret;
+
+    quint32 offset = m_byModelOffset;
+    Field field = Model;
+    QString key = model;
+    if(model.isEmpty() && !package.isEmpty()) {
+        offset = m_byPackageOffset;
+        field = Package;
+        key = package;
+    }
+
+    int first = 0;
+    int last = m_count;
+    if(!key.isEmpty()) {
+        first = lowerBound(offset, 0, m_count, field, key, false);
+        last = lowerBound(offset, first, m_count, field, key, true);
+        if(!newerThan.isEmpty())
+            first = versionBound(offset, first, last, newerThan);
+    }
+
+    for(int i = first; i < last; i++) {
+        int r = indexAt(offset, i);
+        if(record(r)[40] == 0)
+            continue;
+        if(field != Package && !package.isEmpty() && string(r, Package) != package)
+            continue;
+        if(key.isEmpty() && !newerThan.isEmpty() && compareVersion(string(r, Version), newerThan) <= 0)
+            continue;
+        ret << r;
+    }
+    return ret;
+}
+
+bool Catalog::update(const QString &folder,
+                     const QString &filePath,
+                     HeaderReader reader,
+                     int &rescanned) {
+
+    QDir dir(folder);
+    QString catalogPath = QFileInfo(filePath).absoluteFilePath();
+
+    Catalog old;
+    old.open(filePath);
+
+    /* keep records of files whose size and mtime did not change */
+    QList<CatalogRecord> records;
+    QStringList changed;
+    QDirIterator it(dir.absolutePath(), QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+    while(it.hasNext()) {
+        QString path = it.next();
+        if(path == catalogPath)
+            continue;
+
+        QFileInfo info = it.fileInfo();
+        int i = old.indexOf(dir.relativeFilePath(path));
+        if(i >= 0) {
+            CatalogRecord record = old.at(i);
+            if(record.size == info.size() &&
+                    record.mtime == info.lastModified().toMSecsSinceEpoch()) {
+                records << record;
+                continue;
+            }
+        }
+        changed << path;
+    }
+    old.close();
+
+    records += QtConcurrent::blockingMapped<QList<CatalogRecord> >(changed, HeaderScan(dir.absolutePath(), reader));
+    rescanned = changed.size();
+
+    return write(filePath, records);
+}
+
+bool Catalog::write(const QString &filePath, const QList<CatalogRecord> &records) {
+    quint32 count = records.size();
+
+    QByteArray strings(1, 0);
+    QHash<QString, quint32> stringOffsets;
+    stringOffsets.insert(QString(), 0);
+    auto addString = [&](const QString &value) -> quint32 {
+        QHash<QString, quint32>::const_iterator it = stringOffsets.constFind(value);
+        if(it != stringOffsets.constEnd())
+            return it.value();
+        quint32 offset = strings.size();
+        strings += value.toUtf8();
+        strings += char(0);
+        stringOffsets.insert(value, offset);
+        return offset;
+    };
+
+    QVector<quint32> byModel(count);
+    QVector<quint32> byPackage(count);
+    QVector<quint32> byPath(count);
+    for(quint32 i = 0; i < count; i++)
+        byModel[i] = byPackage[i] = byPath[i] = i;
+
+    std::sort(byModel.begin(), byModel.end(), [&](quint32 a, quint32 b) -> bool {
+        const CatalogRecord &r1 = records.at(a), &r2 = records.at(b);
+        if(int cmp = r1.model.compare(r2.model))
+            return cmp < 0;
+        if(int cmp = compareVersion(r1.version, r2.version))
+            return cmp < 0;
+        return r1.path < r2.path;
+    });
+    std::sort(byPackage.begin(), byPackage.end(), [&](quint32 a, quint32 b) -> bool {
+        const CatalogRecord &r1 = records.at(a), &r2 = records.at(b);
+        if(int cmp = r1.package.compare(r2.package))
+            return cmp < 0;
+        if(int cmp = compareVersion(r1.version, r2.version))
+            return cmp < 0;
+        return r1.path < r2.path;
+    });
+    std::sort(byPath.begin(), byPath.end(), [&](quint32 a, quint32 b) -> bool {
+        return records.at(a).path < records.at(b).path;
+    });
+
+    QByteArray recordData;
+    QDataStream recordStream(&recordData, QIODevice::WriteOnly);
+    recordStream.setByteOrder(QDataStream::LittleEndian);
+    for(const CatalogRecord &record : records) {
+        QByteArray checksum(32, 0);
+        if(record.isImage())
+            checksum.replace(0, 32, record.checksum.left(32));
+
+        recordStream << addString(record.path)
+                     << addString(record.model)
+                     << addString(record.package)
+                     << addString(record.version)
+                     << quint32(record.buildDate.isValid() ? record.buildDate.toJulianDay() : 0)
+                     << quint32(0)
+                     << record.size
+                     << record.mtime;
+        recordStream.writeRawData(checksum.constData(), checksum.size());
+    }
+
+    while(strings.size() % 4)
+        strings += char(0);
+
+    quint32 recordOffset = CATALOG_HEADER_SIZE;
+    quint32 stringOffset = recordOffset + recordData.size();
+    quint32 byModelOffset = stringOffset + strings.size();
+    quint32 byPackageOffset = byModelOffset + count * 4;
+    quint32 byPathOffset = byPackageOffset + count * 4;
+
+    QSaveFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream out(&file);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.writeRawData(CATALOG_MAGIC, sizeof(CATALOG_MAGIC));
+    out << count
+        << recordOffset
+        << stringOffset
+        << quint32(strings.size())
+        << byModelOffset
+        << byPackageOffset
+        << byPathOffset;
+    out.writeRawData(QByteArray(CATALOG_HEADER_SIZE - 36, 0).constData(), CATALOG_HEADER_SIZE - 36);
+    out.writeRawData(recordData.constData(), recordData.size());
+    out.writeRawData(strings.constData(), strings.size());
+    for(quint32 i : byModel)
+        out << i;
+    for(quint32 i : byPackage)
+        out << i;
+    for(quint32 i : byPath)
+        out << i;
+
+    return file.commit();
+}
+
+/*
+ * a version part is a number with an optional suffix, ex. "10b": numbers
+ * compare by value, then suffixes as strings; a part without a number
+ * sorts before any number
+ */
+static int compareVersionPart(const QString &p1, const QString &p2) {
+    int d1 = 0, d2 = 0;
+    while(d1 < p1.size() && p1.at(d1).isDigit())
+        d1++;
+    while(d2 < p2.size() && p2.at(d2).isDigit())
+        d2++;
+
+    if(!d1 || !d2) {
+        if(d1 || d2)
+            return d1 ? 1 : -1;
+    }
+    else {
+        /* digit strings without leading zeros, no overflow on long ones */
+        int z1 = 0, z2 = 0;
+        while(z1 < d1 - 1 && p1.at(z1) == '0')
+            z1++;
+        while(z2 < d2 - 1 && p2.at(z2) == '0')
+            z2++;
+
+        int cmp = (d1 - z1) - (d2 - z2);
+        if(!cmp)
+            cmp = p1.midRef(z1, d1 - z1).compare(p2.midRef(z2, d2 - z2));
+        if(cmp)
+            return cmp < 0 ? -1 : 1;
+    }
+
+    int cmp = p1.midRef(d1).compare(p2.midRef(d2));
+    return (cmp > 0) - (cmp < 0);
+}
+
+int Catalog::compareVersion(const QString &v1, const QString &v2) {
+    QStringList list1 = v1.split('.');
+    QStringList list2 = v2.split('.');
+
+    for(int i = 0; i < list1.size() && i < list2.size(); i++) {
+        if(int cmp = compareVersionPart(list1.at(i), list2.at(i)))
+            return cmp;
+    }
+    return (list1.size() > list2.size()) - (list1.size() < list2.size());
+}
+
+bool Catalog::isChecksum(const QByteArray &checksum) {
+    if(checksum.size() != 32)
+        return false;
+    for(char c : checksum) {
+        if(!isxdigit((uchar)c))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,94 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <QFile>
+#include <QDate>
+#include <QList>
+#include <QString>
+#include <QByteArray>
+
+class CatalogRecord {
+public:
+    CatalogRecord() : size(0), mtime(0) {}
+
+    bool isImage() const { return !checksum.isEmpty(); }
+
+    QString path;           // relative to the scanned folder
+    QString model;
+    QString package;
+    QString version;
+    QDate buildDate;
+    QByteArray checksum;    // empty when the file is not an image
+    qint64 size;
+    qint64 mtime;           // msecs since epoch
+};
+
+/*
+ * Header catalog of every file below a folder.
+ *
+ * The catalog is one little endian file which is used through QFile::map():
+ * a fixed size record per file, a string pool and record numbers sorted by
+ * (model, version), (package, version) and path. Queries are binary
+ * searches on the mapped file and do not touch the images themselves.
+ *
+ * Files which are not images are kept too (with an empty checksum), so a
+ * rescan only reads the headers of files whose size or mtime changed.
+ */
+class Catalog
+{
+public:
+    /* fill model, package, version, build date and checksum of a file */
+    typedef bool (*HeaderReader)(const QString &filePath, CatalogRecord &record);
+
+    Catalog();
+    ~Catalog();
+
+    bool open(const QString &filePath);
+    void close();
+
+    int count() const { return m_count; }
+    CatalogRecord at(int i) const;
+
+    /* record of a path relative to the scanned folder, -1 if none */
+    int indexOf(const QString &path) const;
+
+    /*
+     * images of model (and package) with a version newer than newerThan,
+     * any of them may be empty; sorted by model or package, then version
+     */
+    QList<int> find(const QString &model, const QString &package, const QString &newerThan) const;
+
+    /* rescan folder in parallel and rewrite the catalog at filePath */
+    static bool update(const QString &folder, const QString &filePath,
+                       HeaderReader reader, int &rescanned);
+
+    static int compareVersion(const QString &v1, const QString &v2);
+
+    /* header checksum field: 32 hex digits */
+    static bool isChecksum(const QByteArray &checksum);
+
+private:
+    enum Field { Path = 0, Model = 4, Package = 8, Version = 12 };
+
+    const uchar *record(int i) const;
+    QString string(int i, Field field) const;
+    quint32 indexAt(quint32 offset, int i) const;
+    int lowerBound(quint32 offset, int first, int last, Field field,
+                   const QString &value, bool upper) const;
+    int versionBound(quint32 offset, int first, int last, const QString &version) const;
+
+    static bool write(const QString &filePath, const QList<CatalogRecord> &records);
+
+    QFile m_file;
+    const uchar *m_data;
+    qint64 m_size;
+    int m_count;
+    quint32 m_recordOffset;
+    quint32 m_stringOffset;
+    quint32 m_stringSize;
+    quint32 m_byModelOffset;
+    quint32 m_byPackageOffset;
+    quint32 m_byPathOffset;
+};
+
+#endif // CATALOG_H
@@ -0,0 +1,272 @@
+#include "md5mb.h"
+
+#include <QFile>
+#include <QBuffer>
+#include <QVector>
+#include <QCryptographicHash>
+
+#include <functional>
+
+const int MD5MB_CHUNK_SIZE = 65536;    // bytes read per stream at a time
+
+/* scalar engine, one lane */
+#define MD5MB_NAME md5Scalar
+#define MD5MB_LANES 1
+#define V quint32
+#define V_LOADU(p) (*(p))
+#define V_STOREU(p, v) (*(p) = (v))
+#define V_SET1(x) quint32(x)
+#define V_ADD(a, b) ((a) + (b))
+#define V_XOR(a, b) ((a) ^ (b))
+#define V_AND(a, b) ((a) & (b))
+#define V_OR(a, b) ((a) | (b))
+#define V_ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+#include "md5mb_kernel.h"
+
+/*
+ * the SIMD engines are in md5mb_xxx.cpp, built with their own -m flags by
+ * md5mb.pri, which defines MD5MB_xxx for each one it builds
+ */
+#ifdef MD5MB_SSE2
+void md5Sse2(quint32 *state, const uchar *const *data, int nblocks);
+
+static bool hasSse2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+}
+#endif
+
+#ifdef MD5MB_AVX2
+void md5Avx2(quint32 *state, const uchar *const *data, int nblocks);
+
+static bool hasAvx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#ifdef MD5MB_AVX512
+void md5Avx512(quint32 *state, const uchar *const *data, int nblocks);
+
+static bool hasAvx512() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+
+static bool always() {
+    return true;
+}
+
+struct Md5Engine {
+    const char *name;
+    int lanes;
+    void (*compress)(quint32 *, const uchar *const *, int);
+    bool (*supported)();
+};
+
+/* widest first, the scalar engine must stay last */
+static const Md5Engine engines[] = {
+#ifdef MD5MB_AVX512
+    { "avx512 x16", 16, md5Avx512, hasAvx512 },
+#endif
+#ifdef MD5MB_AVX2
+    { "avx2 x8", 8, md5Avx2, hasAvx2 },
+#endif
+#ifdef MD5MB_SSE2
+    { "sse2 x4", 4, md5Sse2, hasSse2 },
+#endif
+    { "scalar", 1, md5Scalar, always }
+};
+
+struct Md5Lane {
+    int job;                // -1 when the lane is idle
+    QIODevice *device;
+    QByteArray buf;
+    int pos;
+    quint64 length;
+    bool last;              // buf ends with the md5 padding
+};
+
+/* read the next chunk of a stream, pad it when the stream ends */
+static void refill(Md5Lane &lane) {
+    lane.buf = lane.device->read(MD5MB_CHUNK_SIZE);
+    while(lane.buf.size() < MD5MB_CHUNK_SIZE) {
+        QByteArray more = lane.device->read(MD5MB_CHUNK_SIZE - lane.buf.size());
+        if(more.isEmpty())
+            break;
+        lane.buf += more;
+    }
+    lane.pos = 0;
+    lane.length += lane.buf.size();
+
+    if(lane.buf.size() < MD5MB_CHUNK_SIZE) {
+        quint64 bits = lane.length * 8;
+        lane.buf += char(0x80);
+        lane.buf += QByteArray((56 - lane.buf.size() % 64 + 64) % 64, 0);
+        for(int i = 0; i < 8; i++)
+            lane.buf += char((bits >> (8 * i)) & 0xff);
+        lane.last = true;
+    }
+}
+
+static QList<QByteArray> run(const Md5Engine &engine,
+                             int count,
+                             std::function<QIODevice *(int)> open,
+                             std::function<void(int, QIODevice *)> release) {
+
+    const int lanes = engine.lanes;
+
+    QList<QByteArray> ret;
+    for(int i = 0; i < count; i++)
+        ret << QByteArray();
+
+    QVector<quint32> state(4 * lanes);
+    QVector<Md5Lane> lane(lanes);
+    QVector<const uchar *> data(lanes);
+    QByteArray idle(MD5MB_CHUNK_SIZE, 0);
+    int next = 0;
+
+    for(int l = 0; l < lanes; l++)
+        lane[l].job = -1;
+
+    forever {
+        int active = 0;
+        int nblocks = MD5MB_CHUNK_SIZE / 64;
+
+        for(int l = 0; l < lanes; l++) {
+            while(lane[l].job < 0 && next < count) {
+                QIODevice *device = open(next);
+                if(!device) {
+                    next++;
+                    continue;
+                }
+                lane[l].job = next++;
+                lane[l].device = device;
+                lane[l].buf.clear();
+                lane[l].pos = 0;
+                lane[l].length = 0;
+                lane[l].last = false;
+                state[0 * lanes + l] = 0x67452301;
+                state[1 * lanes + l] = 0xefcdab89;
+                state[2 * lanes + l] = 0x98badcfe;
+                state[3 * lanes + l] = 0x10325476;
+            }
+
+            if(lane[l].job < 0) {
+                data[l] = reinterpret_cast<const uchar *>(idle.constData());
+                continue;
+            }
+
+            if(lane[l].pos == lane[l].buf.size())
+                refill(lane[l]);
+
+            data[l] = reinterpret_cast<const uchar *>(lane[l].buf.constData()) + lane[l].pos;
+            nblocks = qMin(nblocks, (lane[l].buf.size() - lane[l].pos) / 64);
+            active++;
+        }
+
+        if(!active)
+            break;
+
+        engine.compress(state.data(), data.constData(), nblocks);
+
+        for(int l = 0; l < lanes; l++) {
+            if(lane[l].job < 0)
+                continue;
+
+            lane[l].pos += nblocks * 64;
+            if(lane[l].last && lane[l].pos == lane[l].buf.size()) {
+                QByteArray digest(16, 0);
+                for(int i = 0; i < 16; i++)
+                    digest[i] = char((state[(i / 4) * lanes + l] >> (8 * (i % 4))) & 0xff);
+                ret[lane[l].job] = digest;
+                release(lane[l].job, lane[l].device);
+                lane[l].job = -1;
+            }
+        }
+    }
+
+    return ret;
+}
+
+static QList<QByteArray> run(const Md5Engine &engine, const QList<QIODevice *> &devices) {
+    return run(engine, devices.size(),
+               [&](int i) { return devices.at(i); },
+               [](int, QIODevice *) {});
+}
+
+/* cross-check an engine against QCryptographicHash */
+static bool isEngineValid(const Md5Engine &engine) {
+    QList<int> sizes;
+    sizes << 0 << 1 << 55 << 56 << 63 << 64 << 65 << 119 << 120 << 128
+          << MD5MB_CHUNK_SIZE - 9 << MD5MB_CHUNK_SIZE << 2 * MD5MB_CHUNK_SIZE + 17;
+    for(int i = 0; i < 2 * engine.lanes; i++)
+        sizes << (i * 997) % 5000;
+
+    QList<QByteArray> inputs;
+    QList<QBuffer *> buffers;
+    QList<QIODevice *> devices;
+    quint32 seed = 0x12345678;
+    for(int size : sizes) {
+        QByteArray input(size, 0);
+        for(int i = 0; i < size; i++) {
+            seed = seed * 1103515245 + 12345;
+            input[i] = char(seed >> 24);
+        }
+        inputs << input;
+
+        QBuffer *buffer = new QBuffer;
+        buffer->setData(input);
+        buffer->open(QIODevice::ReadOnly);
+        buffers << buffer;
+        devices << buffer;
+    }
+
+    QList<QByteArray> result = run(engine, devices);
+    qDeleteAll(buffers);
+
+    for(int i = 0; i < inputs.size(); i++) {
+        if(result.at(i) != QCryptographicHash::hash(inputs.at(i), QCryptographicHash::Md5))
+            return false;
+    }
+    return true;
+}
+
+static const Md5Engine &selectEngine() {
+    int count = sizeof(engines) / sizeof(engines[0]);
+    for(int i = 0; i < count - 1; i++) {
+        if(engines[i].supported() && isEngineValid(engines[i]))
+            return engines[i];
+    }
+    return engines[count - 1];
+}
+
+static const Md5Engine &currentEngine() {
+    static const Md5Engine &selected = selectEngine();
+    return selected;
+}
+
+QList<QByteArray> MultiMd5::hash(const QList<QIODevice *> &devices) {
+    return run(currentEngine(), devices);
+}
+
+QList<QByteArray> MultiMd5::hashFiles(const QStringList &paths, qint64 offset) {
+    return run(currentEngine(), paths.size(),
+               [&](int i) -> QIODevice * {
+                   QFile *file = new QFile(paths.at(i));
+                   if(!file->open(QIODevice::ReadOnly) || !file->seek(offset)) {
+                       delete file;
+                       return 0;
+                   }
+                   return file;
+               },
+               [](int, QIODevice *device) {
+                   device->close();
+                   delete device;
+               });
+}
+
+QString MultiMd5::engine() {
+    return currentEngine().name;
+}
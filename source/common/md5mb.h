@@ -0,0 +1,33 @@
+#ifndef MD5MB_H
+#define MD5MB_H
+
+#include <QList>
+#include <QStringList>
+#include <QByteArray>
+#include <QIODevice>
+
+/*
+ * MD5 of many independent streams.
+ *
+ * One MD5 stream can not be vectorized, so the streams are hashed side by
+ * side, one per SIMD lane (4 with SSE2, 8 with AVX2, 16 with AVX-512).
+ * The widest engine the CPU supports is chosen on first use and checked
+ * against QCryptographicHash; the scalar engine is the fallback.
+ *
+ * Results are raw 16 byte digests like QCryptographicHash::result(),
+ * or an empty QByteArray for a stream which could not be read.
+ */
+class MultiMd5
+{
+public:
+    /* md5 of every device, from its current position to the end */
+    static QList<QByteArray> hash(const QList<QIODevice *> &devices);
+
+    /* md5 of every file, the first offset bytes are skipped */
+    static QList<QByteArray> hashFiles(const QStringList &paths, qint64 offset = 0);
+
+    /* name of the selected engine, ex. "avx2 x8" */
+    static QString engine();
+};
+
+#endif // MD5MB_H
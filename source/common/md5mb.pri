@@ -0,0 +1,47 @@
+# multi-buffer md5, see md5mb.h
+#
+# The SIMD engines are built with the -m flags of their instruction set,
+# which gcc 4.8 accepts, and picked at run time by md5mb.cpp. MD5MB_xxx
+# tells md5mb.cpp which engines are built.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/md5mb.cpp
+
+HEADERS += $$PWD/md5mb.h \
+    $$PWD/md5mb_kernel.h
+
+contains(QT_ARCH, i386)|contains(QT_ARCH, x86_64) {
+    MD5MB_SSE2_SOURCES = $$PWD/md5mb_sse2.cpp
+    md5mb_sse2.name = md5mb sse2
+    md5mb_sse2.input = MD5MB_SSE2_SOURCES
+    md5mb_sse2.dependency_type = TYPE_C
+    md5mb_sse2.variable_out = OBJECTS
+    md5mb_sse2.output = ${QMAKE_VAR_OBJECTS_DIR}${QMAKE_FILE_IN_BASE}$${first(QMAKE_EXT_OBJ)}
+    md5mb_sse2.commands = $$QMAKE_CXX -c $(CXXFLAGS) -msse2 $(INCPATH) ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+    QMAKE_EXTRA_COMPILERS += md5mb_sse2
+    DEFINES += MD5MB_SSE2
+
+    MD5MB_AVX2_SOURCES = $$PWD/md5mb_avx2.cpp
+    md5mb_avx2.name = md5mb avx2
+    md5mb_avx2.input = MD5MB_AVX2_SOURCES
+    md5mb_avx2.dependency_type = TYPE_C
+    md5mb_avx2.variable_out = OBJECTS
+    md5mb_avx2.output = ${QMAKE_VAR_OBJECTS_DIR}${QMAKE_FILE_IN_BASE}$${first(QMAKE_EXT_OBJ)}
+    md5mb_avx2.commands = $$QMAKE_CXX -c $(CXXFLAGS) -mavx2 $(INCPATH) ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+    QMAKE_EXTRA_COMPILERS += md5mb_avx2
+    DEFINES += MD5MB_AVX2
+
+    # -mavx512f needs gcc 4.9 and __builtin_cpu_supports("avx512f") gcc 5
+    !lessThan(QT_GCC_MAJOR_VERSION, 5)|*clang* {
+        MD5MB_AVX512_SOURCES = $$PWD/md5mb_avx512.cpp
+        md5mb_avx512.name = md5mb avx512
+        md5mb_avx512.input = MD5MB_AVX512_SOURCES
+        md5mb_avx512.dependency_type = TYPE_C
+        md5mb_avx512.variable_out = OBJECTS
+        md5mb_avx512.output = ${QMAKE_VAR_OBJECTS_DIR}${QMAKE_FILE_IN_BASE}$${first(QMAKE_EXT_OBJ)}
+        md5mb_avx512.commands = $$QMAKE_CXX -c $(CXXFLAGS) -mavx512f $(INCPATH) ${QMAKE_FILE_IN} -o ${QMAKE_FILE_OUT}
+        QMAKE_EXTRA_COMPILERS += md5mb_avx512
+        DEFINES += MD5MB_AVX512
+    }
+}
@@ -0,0 +1,19 @@
+/* avx2 engine, built with -mavx2 (see md5mb.pri) */
+#include <QtGlobal>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+
+#define MD5MB_NAME md5Avx2
+#define MD5MB_LANES 8
+#define V __m256i
+#define V_LOADU(p) _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p))
+#define V_STOREU(p, v) _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), (v))
+#define V_SET1(x) _mm256_set1_epi32(int(x))
+#define V_ADD(a, b) _mm256_add_epi32((a), (b))
+#define V_XOR(a, b) _mm256_xor_si256((a), (b))
+#define V_AND(a, b) _mm256_and_si256((a), (b))
+#define V_OR(a, b) _mm256_or_si256((a), (b))
+#define V_ROTL(x, n) _mm256_or_si256(_mm256_slli_epi32((x), (n)), _mm256_srli_epi32((x), 32 - (n)))
+#include "md5mb_kernel.h"
+#endif
@@ -0,0 +1,19 @@
+/* avx-512 engine, built with -mavx512f (see md5mb.pri) */
+#include <QtGlobal>
+
+#ifdef __AVX512F__
+#include <immintrin.h>
+
+#define MD5MB_NAME md5Avx512
+#define MD5MB_LANES 16
+#define V __m512i
+#define V_LOADU(p) _mm512_loadu_si512(p)
+#define V_STOREU(p, v) _mm512_storeu_si512((p), (v))
+#define V_SET1(x) _mm512_set1_epi32(int(x))
+#define V_ADD(a, b) _mm512_add_epi32((a), (b))
+#define V_XOR(a, b) _mm512_xor_si512((a), (b))
+#define V_AND(a, b) _mm512_and_si512((a), (b))
+#define V_OR(a, b) _mm512_or_si512((a), (b))
+#define V_ROTL(x, n) _mm512_rol_epi32((x), (n))
+#include "md5mb_kernel.h"
+#endif
@@ -0,0 +1,147 @@
+/*
+ * MD5 compression for MD5MB_LANES independent streams at once.
+ *
+ * Included once per instruction set, by md5mb.cpp and by the md5mb_xxx.cpp
+ * files which are built with the compiler flags of their instruction set.
+ * The includer defines MD5MB_NAME, MD5MB_LANES, the vector type V and the
+ * V_xxx operations, which are undefined again at the end of this file.
+ *
+ * state holds a, b, c and d of all lanes, MD5MB_LANES words each.
+ * data[lane] points to nblocks * 64 bytes of input for that lane.
+ */
+
+#define MD5MB_F(b, c, d) V_XOR(d, V_AND(b, V_XOR(c, d)))
+#define MD5MB_G(b, c, d) V_XOR(c, V_AND(d, V_XOR(b, c)))
+#define MD5MB_H(b, c, d) V_XOR(V_XOR(b, c), d)
+#define MD5MB_I(b, c, d) V_XOR(c, V_OR(b, V_XOR(d, V_SET1(0xffffffff))))
+
+#define MD5MB_STEP(f, a, b, c, d, w, t, s) \
+    do { \
+        V sum = V_ADD(V_ADD(a, f(b, c, d)), V_ADD(w, V_SET1(t))); \
+        a = V_ADD(b, V_ROTL(sum, s)); \
+    } while(0)
+
+void MD5MB_NAME(quint32 *state, const uchar *const *data, int nblocks)
+{
+    V a = V_LOADU(state + 0 * MD5MB_LANES);
+    V b = V_LOADU(state + 1 * MD5MB_LANES);
+    V c = V_LOADU(state + 2 * MD5MB_LANES);
+    V d = V_LOADU(state + 3 * MD5MB_LANES);
+
+    for(int n = 0; n < nblocks; n++) {
+        /* transpose the message words of all lanes */
+        quint32 words[16][MD5MB_LANES];
+        for(int lane = 0; lane < MD5MB_LANES; lane++) {
+            const uchar *p = data[lane] + n * 64;
+            for(int i = 0; i < 16; i++, p += 4)
+                words[i][lane] = quint32(p[0]) | (quint32(p[1]) << 8) |
+                                 (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+        }
+
+        V x[16];
+        for(int i = 0; i < 16; i++)
+            x[i] = V_LOADU(words[i]);
+
+        V aa = a, bb = b, cc = c, dd = d;
+
+        /* round 1 */
+        MD5MB_STEP(MD5MB_F, a, b, c, d, x[0], 0xd76aa478, 7);
+        MD5MB_STEP(MD5MB_F, d, a, b, c, x[1], 0xe8c7b756, 12);
+        MD5MB_STEP(MD5MB_F, c, d, a, b, x[2], 0x242070db, 17);
+        MD5MB_STEP(MD5MB_F, b, c, d, a, x[3], 0xc1bdceee, 22);
+        MD5MB_STEP(MD5MB_F, a, b, c, d, x[4], 0xf57c0faf, 7);
+        MD5MB_STEP(MD5MB_F, d, a, b, c, x[5], 0x4787c62a, 12);
+        MD5MB_STEP(MD5MB_F, c, d, a, b, x[6], 0xa8304613, 17);
+        MD5MB_STEP(MD5MB_F, b, c, d, a, x[7], 0xfd469501, 22);
+        MD5MB_STEP(MD5MB_F, a, b, c, d, x[8], 0x698098d8, 7);
+        MD5MB_STEP(MD5MB_F, d, a, b, c, x[9], 0x8b44f7af, 12);
+        MD5MB_STEP(MD5MB_F, c, d, a, b, x[10], 0xffff5bb1, 17);
+        MD5MB_STEP(MD5MB_F, b, c, d, a, x[11], 0x895cd7be, 22);
+        MD5MB_STEP(MD5MB_F, a, b, c, d, x[12], 0x6b901122, 7);
+        MD5MB_STEP(MD5MB_F, d, a, b, c, x[13], 0xfd987193, 12);
+        MD5MB_STEP(MD5MB_F, c, d, a, b, x[14], 0xa679438e, 17);
+        MD5MB_STEP(MD5MB_F, b, c, d, a, x[15], 0x49b40821, 22);
+
+        /* round 2 */
+        MD5MB_STEP(MD5MB_G, a, b, c, d, x[1], 0xf61e2562, 5);
+        MD5MB_STEP(MD5MB_G, d, a, b, c, x[6], 0xc040b340, 9);
+        MD5MB_STEP(MD5MB_G, c, d, a, b, x[11], 0x265e5a51, 14);
+        MD5MB_STEP(MD5MB_G, b, c, d, a, x[0], 0xe9b6c7aa, 20);
+        MD5MB_STEP(MD5MB_G, a, b, c, d, x[5], 0xd62f105d, 5);
+        MD5MB_STEP(MD5MB_G, d, a, b, c, x[10], 0x02441453, 9);
+        MD5MB_STEP(MD5MB_G, c, d, a, b, x[15], 0xd8a1e681, 14);
+        MD5MB_STEP(MD5MB_G, b, c, d, a, x[4], 0xe7d3fbc8, 20);
+        MD5MB_STEP(MD5MB_G, a, b, c, d, x[9], 0x21e1cde6, 5);
+        MD5MB_STEP(MD5MB_G, d, a, b, c, x[14], 0xc33707d6, 9);
+        MD5MB_STEP(MD5MB_G, c, d, a, b, x[3], 0xf4d50d87, 14);
+        MD5MB_STEP(MD5MB_G, b, c, d, a, x[8], 0x455a14ed, 20);
+        MD5MB_STEP(MD5MB_G, a, b, c, d, x[13], 0xa9e3e905, 5);
+        MD5MB_STEP(MD5MB_G, d, a, b, c, x[2], 0xfcefa3f8, 9);
+        MD5MB_STEP(MD5MB_G, c, d, a, b, x[7], 0x676f02d9, 14);
+        MD5MB_STEP(MD5MB_G, b, c, d, a, x[12], 0x8d2a4c8a, 20);
+
+        /* round 3 */
+        MD5MB_STEP(MD5MB_H, a, b, c, d, x[5], 0xfffa3942, 4);
+        MD5MB_STEP(MD5MB_H, d, a, b, c, x[8], 0x8771f681, 11);
+        MD5MB_STEP(MD5MB_H, c, d, a, b, x[11], 0x6d9d6122, 16);
+        MD5MB_STEP(MD5MB_H, b, c, d, a, x[14], 0xfde5380c, 23);
+        MD5MB_STEP(MD5MB_H, a, b, c, d, x[1], 0xa4beea44, 4);
+        MD5MB_STEP(MD5MB_H, d, a, b, c, x[4], 0x4bdecfa9, 11);
+        MD5MB_STEP(MD5MB_H, c, d, a, b, x[7], 0xf6bb4b60, 16);
+        MD5MB_STEP(MD5MB_H, b, c, d, a, x[10], 0xbebfbc70, 23);
+        MD5MB_STEP(MD5MB_H, a, b, c, d, x[13], 0x289b7ec6, 4);
+        MD5MB_STEP(MD5MB_H, d, a, b, c, x[0], 0xeaa127fa, 11);
+        MD5MB_STEP(MD5MB_H, c, d, a, b, x[3], 0xd4ef3085, 16);
+        MD5MB_STEP(MD5MB_H, b, c, d, a, x[6], 0x04881d05, 23);
+        MD5MB_STEP(MD5MB_H, a, b, c, d, x[9], 0xd9d4d039, 4);
+        MD5MB_STEP(MD5MB_H, d, a, b, c, x[12], 0xe6db99e5, 11);
+        MD5MB_STEP(MD5MB_H, c, d, a, b, x[15], 0x1fa27cf8, 16);
+        MD5MB_STEP(MD5MB_H, b, c, d, a, x[2], 0xc4ac5665, 23);
+
+        /* round 4 */
+        MD5MB_STEP(MD5MB_I, a, b, c, d, x[0], 0xf4292244, 6);
+        MD5MB_STEP(MD5MB_I, d, a, b, c, x[7], 0x432aff97, 10);
+        MD5MB_STEP(MD5MB_I, c, d, a, b, x[14], 0xab9423a7, 15);
+        MD5MB_STEP(MD5MB_I, b, c, d, a, x[5], 0xfc93a039, 21);
+        MD5MB_STEP(MD5MB_I, a, b, c, d, x[12], 0x655b59c3, 6);
+        MD5MB_STEP(MD5MB_I, d, a, b, c, x[3], 0x8f0ccc92, 10);
+        MD5MB_STEP(MD5MB_I, c, d, a, b, x[10], 0xffeff47d, 15);
+        MD5MB_STEP(MD5MB_I, b, c, d, a, x[1], 0x85845dd1, 21);
+        MD5MB_STEP(MD5MB_I, a, b, c, d, x[8], 0x6fa87e4f, 6);
+        MD5MB_STEP(MD5MB_I, d, a, b, c, x[15], 0xfe2ce6e0, 10);
+        MD5MB_STEP(MD5MB_I, c, d, a, b, x[6], 0xa3014314, 15);
+        MD5MB_STEP(MD5MB_I, b, c, d, a, x[13], 0x4e0811a1, 21);
+        MD5MB_STEP(MD5MB_I, a, b, c, d, x[4], 0xf7537e82, 6);
+        MD5MB_STEP(MD5MB_I, d, a, b, c, x[11], 0xbd3af235, 10);
+        MD5MB_STEP(MD5MB_I, c, d, a, b, x[2], 0x2ad7d2bb, 15);
+        MD5MB_STEP(MD5MB_I, b, c, d, a, x[9], 0xeb86d391, 21);
+
+        a = V_ADD(a, aa);
+        b = V_ADD(b, bb);
+        c = V_ADD(c, cc);
+        d = V_ADD(d, dd);
+    }
+
+    V_STOREU(state + 0 * MD5MB_LANES, a);
+    V_STOREU(state + 1 * MD5MB_LANES, b);
+    V_STOREU(state + 2 * MD5MB_LANES, c);
+    V_STOREU(state + 3 * MD5MB_LANES, d);
+}
+
+#undef MD5MB_F
+#undef MD5MB_G
+#undef MD5MB_H
+#undef MD5MB_I
+#undef MD5MB_STEP
+
+#undef MD5MB_NAME
+#undef MD5MB_LANES
+#undef V
+#undef V_LOADU
+#undef V_STOREU
+#undef V_SET1
+#undef V_ADD
+#undef V_XOR
+#undef V_AND
+#undef V_OR
+#undef V_ROTL
@@ -0,0 +1,19 @@
+/* sse2 engine, built with -msse2 (see md5mb.pri) */
+#include <QtGlobal>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+#define MD5MB_NAME md5Sse2
+#define MD5MB_LANES 4
+#define V __m128i
+#define V_LOADU(p) _mm_loadu_si128(reinterpret_cast<const __m128i *>(p))
+#define V_STOREU(p, v) _mm_storeu_si128(reinterpret_cast<__m128i *>(p), (v))
+#define V_SET1(x) _mm_set1_epi32(int(x))
+#define V_ADD(a, b) _mm_add_epi32((a), (b))
+#define V_XOR(a, b) _mm_xor_si128((a), (b))
+#define V_AND(a, b) _mm_and_si128((a), (b))
+#define V_OR(a, b) _mm_or_si128((a), (b))
+#define V_ROTL(x, n) _mm_or_si128(_mm_slli_epi32((x), (n)), _mm_srli_epi32((x), 32 - (n)))
+#include "md5mb_kernel.h"
+#endif
@@ -0,0 +1,520 @@
+#include "apkgarchive.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <cmath>
+
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pwd.h>
+#include <grp.h>
+#include <zlib.h>
+
+const int TAR_BLOCK_SIZE = 512;
+const int TAR_RECORD_SIZE = 10240;
+
+const int DEFLATE_WINDOW_SIZE = 32768;
+
+const int ENTROPY_SAMPLE_SIZE = 8192;
+const double ENTROPY_STORED = 7.5;     // bits per byte
+const double ENTROPY_FAST = 6.0;
+
+/* raw deflate of archive members, ended with a sync flush */
+class ChunkDeflater
+{
+public:
+    explicit ChunkDeflater(int level)
+        : m_crc(crc32(0L, Z_NULL, 0)), m_length(0), m_keepTail(false),
+          m_device(0), m_hash(0) {
+        init(level);
+    }
+
+    /*
+     * member of an incremental archive: dictionary is the data before it in
+     * the final stream, so back references may reach into it, and the tail
+     * is kept as dictionary of the next member
+     */
+    ChunkDeflater(int level, const QByteArray &dictionary)
+        : m_crc(crc32(0L, Z_NULL, 0)), m_length(0), m_keepTail(true),
+          m_device(0), m_hash(0) {
+        init(level);
+        if(m_ok && !dictionary.isEmpty())
+            m_ok = (deflateSetDictionary(&m_stream,
+                                         reinterpret_cast<const Bytef *>(dictionary.constData()),
+                                         dictionary.size()) == Z_OK);
+    }
+
+    ~ChunkDeflater() {
+        if(m_ok)
+            deflateEnd(&m_stream);
+    }
+
+    /* write the deflate data to out and hash instead of keeping it */
+    void setOutput(QIODevice *out, QCryptographicHash *hash) {
+        m_device = out;
+        m_hash = hash;
+    }
+
+    bool isValid() const { return m_ok; }
+    quint32 crc() const { return m_crc; }
+    qint64 length() const { return m_length; }
+
+    /* last DEFLATE_WINDOW_SIZE bytes of the uncompressed data */
+    QByteArray tail() const { return m_tail.right(DEFLATE_WINDOW_SIZE); }
+
+    void addData(const QByteArray &data) {
+        m_crc = crc32(m_crc, reinterpret_cast<const Bytef *>(data.constData()), data.size());
+        m_length += data.size();
+        if(m_keepTail) {
+            m_tail += data;
+            if(m_tail.size() > 2 * DEFLATE_WINDOW_SIZE)
+                m_tail = m_tail.right(DEFLATE_WINDOW_SIZE);
+        }
+        run(data, Z_NO_FLUSH);
+    }
+
+    /* level of the data added from now on */
+    void setLevel(int level) {
+        if(!m_ok)
+            return;
+
+        /* drain pending output first, deflateParams() only has a small buffer */
+        run(QByteArray(), Z_BLOCK);
+
+        char buf[16384];
+        m_stream.next_in = Z_NULL;
+        m_stream.avail_in = 0;
+        m_stream.next_out = reinterpret_cast<Bytef *>(buf);
+        m_stream.avail_out = sizeof(buf);
+        if(deflateParams(&m_stream, level, Z_DEFAULT_STRATEGY) == Z_STREAM_ERROR)
+            m_ok = false;
+        output(buf, sizeof(buf) - m_stream.avail_out);
+    }
+
+    QByteArray finish() {
+        run(QByteArray(), Z_SYNC_FLUSH);
+        return m_out;
+    }
+
+private:
+    void init(int level) {
+        memset(&m_stream, 0, sizeof(m_stream));
+        m_ok = (deflateInit2(&m_stream, level, Z_DEFLATED, -MAX_WBITS,
+                             8, Z_DEFAULT_STRATEGY) == Z_OK);
+    }
+
+    void run(const QByteArray &data, int flush) {
+        if(!m_ok)
+            return;
+
+        char buf[16384];
+        m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.constData()));
+        m_stream.avail_in = data.size();
+        do {
+            m_stream.next_out = reinterpret_cast<Bytef *>(buf);
+            m_stream.avail_out = sizeof(buf);
+            if(deflate(&m_stream, flush) == Z_STREAM_ERROR) {
+                m_ok = false;
+                return;
+            }
+            output(buf, sizeof(buf) - m_stream.avail_out);
+        } while(m_ok && m_stream.avail_out == 0);
+    }
+
+    void output(const char *data, int size) {
+        if(!m_device) {
+            m_out.append(data, size);
+            return;
+        }
+        m_hash->addData(data, size);
+        if(m_device->write(data, size) != size)
+            m_ok = false;
+    }
+
+    z_stream m_stream;
+    bool m_ok;
+    quint32 m_crc;
+    qint64 m_length;
+    bool m_keepTail;
+    QByteArray m_tail;
+    QIODevice *m_device;
+    QCryptographicHash *m_hash;
+    QByteArray m_out;
+};
+
+/* numeric tar field, base-256 when the value does not fit in octal */
+static void setTarNumber(char *field, int width, quint64 value) {
+    if(value >> (3 * (width - 1))) {
+        for(int i = width - 1; i > 0; i--) {
+            field[i] = char(value & 0xff);
+            value >>= 8;
+        }
+        field[0] = char(0x80);
+    }
+    else
+        qsnprintf(field, width, "%0*llo", width - 1, (unsigned long long)value);
+}
+
+static void setTarString(char *field, int width, const QByteArray &value) {
+    memcpy(field, value.constData(), qMin(width, value.size()));
+}
+
+static QByteArray userName(quint32 uid) {
+    static QHash<quint32, QByteArray> names;
+    if(!names.contains(uid)) {
+        struct passwd *pw = getpwuid(uid);
+        names.insert(uid, pw ? QByteArray(pw->pw_name) : QByteArray());
+    }
+    return names.value(uid);
+}
+
+static QByteArray groupName(quint32 gid) {
+    static QHash<quint32, QByteArray> names;
+    if(!names.contains(gid)) {
+        struct group *gr = getgrgid(gid);
+        names.insert(gid, gr ? QByteArray(gr->gr_name) : QByteArray());
+    }
+    return names.value(gid);
+}
+
+/* one GNU tar header block */
+static QByteArray tarBlock(const QByteArray &name, char type, quint64 size,
+                           quint32 mode, quint32 uid, quint32 gid, qint64 mtime,
+                           const QByteArray &link) {
+    QByteArray block(TAR_BLOCK_SIZE, 0);
+    char *h = block.data();
+
+    setTarString(h, 100, name);
+    setTarNumber(h + 100, 8, mode & 07777);
+    setTarNumber(h + 108, 8, uid);
+    setTarNumber(h + 116, 8, gid);
+    setTarNumber(h + 124, 12, size);
+    setTarNumber(h + 136, 12, mtime < 0 ? 0 : mtime);
+    memset(h + 148, ' ', 8);
+    h[156] = type;
+    setTarString(h + 157, 100, link);
+    memcpy(h + 257, "ustar  ", 8);
+    setTarString(h + 265, 32, userName(uid));
+    setTarString(h + 297, 32, groupName(gid));
+
+    unsigned int sum = 0;
+    for(int i = 0; i < TAR_BLOCK_SIZE; i++)
+        sum += (unsigned char)h[i];
+    qsnprintf(h + 148, 7, "%06o", sum);
+
+    return block;
+}
+
+static QByteArray tarPadding(qint64 size) {
+    return QByteArray(int((TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE), 0);
+}
+
+/* end of archive, padded to a whole record like tar does */
+static QByteArray tarEnd(qint64 size) {
+    qint64 eof = 2 * TAR_BLOCK_SIZE;
+    eof += (TAR_RECORD_SIZE - (size + eof) % TAR_RECORD_SIZE) % TAR_RECORD_SIZE;
+    return QByteArray(int(eof), 0);
+}
+
+/* GNU long name/link record for values which do not fit in 100 bytes */
+static QByteArray tarLongRecord(char type, const QByteArray &value) {
+    QByteArray ret = tarBlock("././@LongLink", type, value.size() + 1, 0, 0, 0, 0, QByteArray());
+    ret += value;
+    ret += char(0);
+    ret += tarPadding(value.size() + 1);
+    return ret;
+}
+
+/* shannon entropy of the byte values, 0 to 8 bits per byte */
+static double entropy(const QByteArray &data) {
+    if(data.isEmpty())
+        return 0;
+
+    quint32 count[256] = { 0 };
+    for(int i = 0; i < data.size(); i++)
+        count[(uchar)data.at(i)]++;
+
+    double ret = 0;
+    for(int i = 0; i < 256; i++) {
+        if(count[i]) {
+            double p = double(count[i]) / data.size();
+            ret -= p * std::log(p) / std::log(2.0);
+        }
+    }
+    return ret;
+}
+
+/* pick a deflate level from the head, middle and tail of the file */
+static int compressLevel(QFile &file, qint64 size) {
+    QByteArray sample;
+    if(size <= 3 * ENTROPY_SAMPLE_SIZE)
+        sample = file.read(size);
+    else {
+        sample = file.read(ENTROPY_SAMPLE_SIZE);
+        file.seek(size / 2);
+        sample += file.read(ENTROPY_SAMPLE_SIZE);
+        file.seek(size - ENTROPY_SAMPLE_SIZE);
+        sample += file.read(ENTROPY_SAMPLE_SIZE);
+    }
+    file.seek(0);
+
+    double bits = entropy(sample);
+    if(bits >= ENTROPY_STORED)
+        return Z_NO_COMPRESSION;
+    if(bits >= ENTROPY_FAST)
+        return Z_BEST_SPEED;
+    return Z_DEFAULT_COMPRESSION;
+}
+
+ApkgArchive::ApkgArchive(const QDir &sourceFolder, bool incremental)
+    : m_sourceFolder(sourceFolder), m_incremental(incremental) {
+}
+
+int ApkgArchive::scan() {
+    QStringList order;
+    QHash<QString, Entry> entries;
+    int changed = 0;
+
+    qint64 offset = 0;
+    qint64 unchanged = 0;
+    scanPath(m_sourceFolder.absolutePath(), m_sourceFolder.dirName(),
+             order, entries, changed, offset, unchanged);
+
+    for(const QString &name : m_order) {
+        if(!entries.contains(name))
+            changed++;
+    }
+
+    m_order = order;
+    m_entries = entries;
+    return changed;
+}
+
+void ApkgArchive::scanPath(const QString &path,
+                           const QString &archivePath,
+                           QStringList &order,
+                           QHash<QString, Entry> &entries,
+                           int &changed,
+                           qint64 &offset,
+                           qint64 &unchanged) {
+
+    QByteArray localPath = QFile::encodeName(path);
+    struct stat st;
+    if(::lstat(localPath.constData(), &st) != 0) {
+        qDebug() << "File: " << path << " could not be read.";
+        return;
+    }
+
+    if(!S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode) && !S_ISLNK(st.st_mode)) {
+        qDebug() << "File: " << path << " is not a regular file, skipped.";
+        return;
+    }
+
+    Entry entry;
+    entry.size = S_ISREG(st.st_mode) ? st.st_size : 0;
+    entry.mtime = qint64(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    entry.mode = st.st_mode;
+    entry.uid = st.st_uid;
+    entry.gid = st.st_gid;
+
+    if(S_ISLNK(st.st_mode)) {
+        QByteArray link(int(st.st_size) + 1, 0);
+        ssize_t len = ::readlink(localPath.constData(), link.data(), link.size());
+        if(len < 0) {
+            qDebug() << "File: " << path << " could not be read.";
+            return;
+        }
+        link.truncate(int(len));
+        entry.link = link;
+    }
+
+    QString archiveName = archivePath;
+    if(S_ISDIR(st.st_mode))
+        archiveName += "/";
+
+    entry.path = path;
+
+    if(!m_incremental) {
+        /* deflated as one stream by write() */
+        changed++;
+    }
+    else {
+        /*
+         * a member is deflated with the last 32K before it as dictionary, so
+         * it is kept only when the members before it are the same, in the
+         * same order, for 32K or up to the start of the archive; unchanged
+         * counts the bytes since the last member which moved or changed
+         */
+        entry.previous = order.isEmpty() ? QString() : order.last();
+
+        QHash<QString, Entry>::const_iterator old = m_entries.constFind(archiveName);
+        bool samePlace = old != m_entries.constEnd() && old->previous == entry.previous;
+        bool sameData = old != m_entries.constEnd() &&
+                old->size == entry.size &&
+                old->mtime == entry.mtime &&
+                old->mode == entry.mode &&
+                old->uid == entry.uid &&
+                old->gid == entry.gid &&
+                old->link == entry.link;
+        if(!samePlace)
+            unchanged = 0;
+
+        if(samePlace && sameData &&
+                (unchanged >= DEFLATE_WINDOW_SIZE || unchanged == offset)) {
+            entry = *old;
+        }
+        else {
+            QByteArray window;
+            for(int i = order.size() - 1; i >= 0 && window.size() < DEFLATE_WINDOW_SIZE; i--)
+                window.prepend(entries.value(order.at(i)).tail);
+
+            ChunkDeflater deflater(Z_DEFAULT_COMPRESSION, window.right(DEFLATE_WINDOW_SIZE));
+            if(!compress(path, archiveName, entry, deflater))
+                return;
+            entry.chunk = deflater.finish();
+            entry.crc = deflater.crc();
+            entry.length = deflater.length();
+            entry.tail = deflater.tail();
+            if(!deflater.isValid()) {
+                qDebug() << "File: " << path << " could not be compressed.";
+                return;
+            }
+            changed++;
+        }
+
+        offset += entry.length;
+        unchanged = sameData ? unchanged + entry.length : 0;
+    }
+
+    order << archiveName;
+    entries.insert(archiveName, entry);
+
+    if(S_ISDIR(st.st_mode)) {
+        QStringList list = QDir(path).entryList(QDir::AllEntries | QDir::Hidden |
+                                                QDir::System | QDir::NoDotAndDotDot,
+                                                QDir::Name);
+        for(const QString &e : list)
+            scanPath(path + "/" + e, archivePath + "/" + e, order, entries, changed,
+                     offset, unchanged);
+    }
+}
+
+bool ApkgArchive::compress(const QString &path,
+                           const QString &archiveName,
+                           const Entry &entry,
+                           ChunkDeflater &deflater) const {
+
+    char type = '0';
+    if(S_ISDIR(entry.mode))
+        type = '5';
+    else if(S_ISLNK(entry.mode))
+        type = '2';
+
+    /* open before anything of the member goes to the deflater */
+    QFile file(path);
+    if(type == '0' && !file.open(QIODevice::ReadOnly)) {
+        qDebug() << "File: " << path << " could not be read.";
+        return false;
+    }
+
+    QByteArray name = QFile::encodeName(archiveName);
+    QByteArray header;
+    if(name.size() > 100)
+        header += tarLongRecord('L', name);
+    if(entry.link.size() > 100)
+        header += tarLongRecord('K', entry.link);
+    header += tarBlock(name, type, entry.size, entry.mode, entry.uid, entry.gid,
+                       entry.mtime / 1000000000, entry.link);
+
+    deflater.addData(header);
+
+    if(type == '0') {
+        int level = compressLevel(file, entry.size);
+        if(level != Z_DEFAULT_COMPRESSION)
+            deflater.setLevel(level);
+
+        int bufSize = 65536;
+        qint64 remain = entry.size;
+        while(remain > 0) {
+            QByteArray buf = file.read(qMin<qint64>(bufSize, remain));
+            if(buf.isEmpty())
+                break;
+            deflater.addData(buf);
+            remain -= buf.size();
+        }
+        file.close();
+
+        /* file shrank while reading, keep the size in the header */
+        if(remain > 0) {
+            qDebug() << "File: " << path << " shrank while reading.";
+            deflater.addData(QByteArray(int(remain), 0));
+        }
+
+        if(level != Z_DEFAULT_COMPRESSION)
+            deflater.setLevel(Z_DEFAULT_COMPRESSION);
+        deflater.addData(tarPadding(entry.size));
+    }
+
+    qDebug() << qPrintable(archiveName);
+    return true;
+}
+
+bool ApkgArchive::write(QIODevice &out, QCryptographicHash &hash) const {
+
+    auto put = [&](const QByteArray &data) -> bool {
+        hash.addData(data);
+        return out.write(data) == data.size();
+    };
+
+    /* gzip member header: deflate, no flags, no mtime, unix */
+    static const char gzipHeader[10] = { 0x1f, char(0x8b), 8, 0, 0, 0, 0, 0, 0, 3 };
+    if(!put(QByteArray(gzipHeader, sizeof(gzipHeader))))
+        return false;
+
+    quint32 crc = 0;
+    qint64 length = 0;
+    if(!m_incremental) {
+        /* straight to out, the archive is never held in memory */
+        ChunkDeflater stream(Z_DEFAULT_COMPRESSION);
+        stream.setOutput(&out, &hash);
+        for(const QString &name : m_order) {
+            const Entry &entry = m_entries[name];
+            compress(entry.path, name, entry, stream);
+        }
+        stream.addData(tarEnd(stream.length()));
+        stream.finish();
+        if(!stream.isValid())
+            return false;
+        crc = stream.crc();
+        length = stream.length();
+    }
+    else {
+        crc = crc32(0L, Z_NULL, 0);
+        length = 0;
+        for(const QString &name : m_order) {
+            const Entry &entry = m_entries[name];
+            if(!put(entry.chunk))
+                return false;
+            crc = crc32_combine(crc, entry.crc, entry.length);
+            length += entry.length;
+        }
+
+        ChunkDeflater deflater(Z_DEFAULT_COMPRESSION);
+        deflater.addData(tarEnd(length));
+        if(!put(deflater.finish()))
+            return false;
+        crc = crc32_combine(crc, deflater.crc(), deflater.length());
+        length += deflater.length();
+    }
+
+    /* final empty block, then crc32 and length modulo 2^32 */
+    QByteArray trailer(10, 0);
+    trailer[0] = 0x03;
+    trailer[1] = 0x00;
+    for(int i = 0; i < 4; i++) {
+        trailer[2 + i] = char((crc >> (8 * i)) & 0xff);
+        trailer[6 + i] = char((quint32(length) >> (8 * i)) & 0xff);
+    }
+    return put(trailer);
+}
@@ -0,0 +1,71 @@
+#ifndef APKGARCHIVE_H
+#define APKGARCHIVE_H
+
+#include <QDir>
+#include <QHash>
+#include <QStringList>
+#include <QByteArray>
+#include <QCryptographicHash>
+
+class ChunkDeflater;
+
+/*
+ * Builds the "tar zcvf" payload of an add-on in-process.
+ *
+ * By default the whole archive is one deflate stream, like tar z: scan()
+ * only lists the members and write() deflates them straight to the output.
+ *
+ * Incremental archives deflate every member (tar header + data + padding)
+ * on its own, with the last 32K of the archive before it as dictionary,
+ * and end it on a byte boundary (Z_SYNC_FLUSH), so the members can be
+ * stitched into a single gzip stream with one header and one trailer.
+ * Members whose file and preceding data did not change are kept between
+ * scan() calls and are not compressed again.
+ *
+ * The deflate level of a file follows the entropy of a sample of its
+ * data: already compressed files (images, .gz, ...) are stored, dense
+ * ones get a fast level and the rest the default level of gzip.
+ */
+class ApkgArchive
+{
+public:
+    explicit ApkgArchive(const QDir &sourceFolder, bool incremental = false);
+
+    /* walk the source folder and recompress changed members, returns how many changed */
+    int scan();
+
+    /* write the gzip stream to out and feed it to hash */
+    bool write(QIODevice &out, QCryptographicHash &hash) const;
+
+    int entryCount() const { return m_order.size(); }
+
+private:
+    struct Entry {
+        QString path;       // absolute path of the file
+        qint64 size;
+        qint64 mtime;       // nanoseconds
+        quint32 mode;
+        quint32 uid;
+        quint32 gid;
+        QByteArray link;    // symbolic link target
+
+        QByteArray chunk;   // raw deflate data, sync flushed
+        quint32 crc;        // crc32 of the uncompressed member
+        qint64 length;      // length of the uncompressed member
+        QByteArray tail;    // last 32K of the uncompressed member
+        QString previous;   // archive name of the member before it
+    };
+
+    void scanPath(const QString &path, const QString &archivePath,
+                  QStringList &order, QHash<QString, Entry> &entries, int &changed,
+                  qint64 &offset, qint64 &unchanged);
+    bool compress(const QString &path, const QString &archiveName,
+                  const Entry &entry, ChunkDeflater &deflater) const;
+
+    QDir m_sourceFolder;
+    bool m_incremental;
+    QStringList m_order;                // archive names in tar order
+    QHash<QString, Entry> m_entries;
+};
+
+#endif // APKGARCHIVE_H
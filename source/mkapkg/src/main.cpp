@@ -4,17 +4,37 @@
 #include <QFile>
 #include <QDir>
 //#include <QSettings>
-#include <QProcess>
 #include <QMap>
 #include <QDateTime>
 #include <QCryptographicHash>
 #include <QDataStream>
+#include <QSaveFile>
+#include <QTimer>
+#include <QSocketNotifier>
+#include <QElapsedTimer>
 
+#include <sys/inotify.h>
+#include <unistd.h>
 
-const QString PACKAGE_TEMP_FILE = "pkg.tgz";
+#include <functional>
+
+#include "apkgarchive.h"
+#include "md5mb.h"
+#include "catalog.h"
+
+const QString CATALOG_FILE = ".mkapkg.catalog";
 
 void packageFile(QDir, QDir, QMap<QString, QString> &, QString, int);
+int watchFolder(QString, QString, int, int);
+bool isPackageValid(QDir, QDir, QMap<QString, QString> &, QString);
+QByteArray packageHeader(QMap<QString, QString> &, QString, int);
+QString packageFilePath(QDir, QMap<QString, QString> &, QString);
+bool writePackage(QString, QByteArray, const ApkgArchive &, QByteArray &);
 void unpackageFile(QString);
+int verifyFiles(QStringList);
+int indexFolder(QString, QString);
+int queryCatalog(QString, QString, QString, QString, QString);
+bool readCatalogHeader(const QString &, CatalogRecord &);
 QMap<QString, QString> getRC(QString);
 void showModels(QStringList &);
 QStringList getSupportModels();
@@ -66,6 +86,126 @@ int main(int argc, char *argv[])
         else
             qDebug() << "You must select a source file.";
     }
+    else if (command == "verify") {
+        parser.setApplicationDescription("mkapkg helper\n\n"
+                                         "ex. mkapkg verify <file> [<file> ...]");
+
+        parser.addHelpOption();
+        parser.addPositionalArgument("verify", "verify checksum of your APPs.", "verify <file> [<file> ...]");
+
+        parser.process(app);
+
+        QStringList files = parser.positionalArguments().mid(1);
+        if(!files.isEmpty())
+            return verifyFiles(files);
+        else
+            qDebug() << "You must select a source file.";
+    }
+    else if (command == "index") {
+        parser.setApplicationDescription("mkapkg helper\n\n"
+                                         "ex. mkapkg index <folder>\n"
+                                         "(Catalog the add-on headers below folder for mkapkg query.)");
+
+        parser.addHelpOption();
+        parser.addPositionalArgument("index", "index your APPs.", "index <folder> [index_options]");
+
+        QCommandLineOption catalogOption(QStringList() << "c" << "catalog",
+                                           "Select a catalog file <catalog file>.",
+                                           "catalog file");
+        parser.addOption(catalogOption);
+
+        parser.process(app);
+
+        QString folder = parser.positionalArguments().value(1, QDir::currentPath());
+        QString catalogFile = parser.value(catalogOption);
+        if(catalogFile.isEmpty())
+            catalogFile = QDir(folder).filePath(CATALOG_FILE);
+
+        return indexFolder(folder, catalogFile);
+    }
+    else if (command == "query") {
+        parser.setApplicationDescription("mkapkg helper\n\n"
+                                         "ex. mkapkg query <folder> -m <model> -p <package> -n <version>\n"
+                                         "(Search the catalog made by mkapkg index.)");
+
+        parser.addHelpOption();
+        parser.addPositionalArgument("query", "query your APPs.", "query <folder> [query_options]");
+
+        QCommandLineOption modelNameOption(QStringList() << "m" << "model-name",
+                                           "Select a model name <model name>.",
+                                           "model name");
+        parser.addOption(modelNameOption);
+
+        QCommandLineOption packageNameOption(QStringList() << "p" << "package-name",
+                                           "Select a package name <package name>.",
+                                           "package name");
+        parser.addOption(packageNameOption);
+
+        QCommandLineOption newerOption(QStringList() << "n" << "newer-than",
+                                           "Select packages newer than <version>.",
+                                           "version");
+        parser.addOption(newerOption);
+
+        QCommandLineOption catalogOption(QStringList() << "c" << "catalog",
+                                           "Select a catalog file <catalog file>.",
+                                           "catalog file");
+        parser.addOption(catalogOption);
+
+        parser.process(app);
+
+        QString folder = parser.positionalArguments().value(1, QDir::currentPath());
+        QString catalogFile = parser.value(catalogOption);
+        if(catalogFile.isEmpty())
+            catalogFile = QDir(folder).filePath(CATALOG_FILE);
+
+        return queryCatalog(folder, catalogFile,
+                            parser.value(modelNameOption),
+                            parser.value(packageNameOption),
+                            parser.value(newerOption));
+    }
+    else if (command == "watch") {
+        QStringList supportList = getSupportModels();
+
+        parser.setApplicationDescription("mkapkg helper\n\n"
+                                         "ex. mkapkg watch -m <model> -s <folder>\n"
+                                         "(Repack the add-on whenever the source folder changes.)");
+
+        parser.addHelpOption();
+        parser.addPositionalArgument("watch", "watch and repack your APP.", "watch [package_options]");
+
+        QCommandLineOption modelNameOption(QStringList() << "m" << "model-name",
+                                           "Select a model name <model name>.",
+                                           "model name");
+        parser.addOption(modelNameOption);
+
+        QCommandLineOption sourceFolderOption(QStringList() << "s" << "source-folder",
+                                           "Select a source folder <source folder>.",
+                                           "source folder",
+                                           QDir::currentPath());
+        parser.addOption(sourceFolderOption);
+
+        QCommandLineOption debounceOption(QStringList() << "t" << "debounce",
+                                           "Wait <msec> for more changes before repacking.",
+                                           "msec",
+                                           "50");
+        parser.addOption(debounceOption);
+
+        parser.process(app);
+
+        if (!supportList.contains(parser.value(modelNameOption))) {
+            qDebug() << "ERROR: model_name is not specify.\n";
+            showModels(supportList);
+            return 0;
+        }
+
+        int i3rdPatry = 0;
+        if(args.contains("1"))
+            i3rdPatry = 1;
+
+        QString sourceFolder = QDir::cleanPath(QDir(parser.value(sourceFolderOption)).absolutePath());
+        return watchFolder(sourceFolder, parser.value(modelNameOption),
+                           i3rdPatry, parser.value(debounceOption).toInt());
+    }
     else {
         QStringList supportList = getSupportModels();
 
@@ -73,7 +213,14 @@ int main(int argc, char *argv[])
                                          //"ex. mkapkg -m <model> -s <folder> -d <folder>\n"
                                          "ex. mkapkg -m <model> -s <folder>\n"
                                          "ex. mkapkg -m <model>\n"
-                                         "(If source is not selected, mkapkg will use current path.\n)");
+                                         "(If source is not selected, mkapkg will use current path.\n)\n\n"
+                                         "For watch help:\n"
+                                         "mkapkg watch --help\n"
+                                         "For verify help:\n"
+                                         "mkapkg verify --help\n"
+                                         "For index and query help:\n"
+                                         "mkapkg index --help\n"
+                                         "mkapkg query --help");
         //parser.clearPositionalArguments();
         parser.addHelpOption();
         //parser.addPositionalArgument("pack", "pack your APP.", "pack [package_options]");
@@ -157,6 +304,162 @@ void packageFile(QDir sourceFolder,
                  QString modelName,
                  int i3rdParty) {
 
+    if(!isPackageValid(sourceFolder, destFolder, map, modelName))
+        return;
+
+    qDebug();
+    qDebug() << "============================================";
+    qDebug() << "	 mkapkg version: " << QCoreApplication::applicationVersion();
+    qDebug() << "============================================";
+    qDebug();
+
+    ApkgArchive archive(sourceFolder);
+    archive.scan();
+
+    QString filePath = packageFilePath(destFolder, map, modelName);
+    QByteArray checkSum;
+    if(!writePackage(filePath, packageHeader(map, modelName, i3rdParty), archive, checkSum))
+        return;
+
+    qDebug();
+    qDebug() << "Model name:		" << modelName;
+    qDebug() << "Package name:		" << map.value("Package");
+    qDebug() << "Package version:	" << map.value("Version");
+    qDebug() << "Packager:	        " << map.value("Packager");
+    qDebug();
+    qDebug() << "Package checksum:	" << checkSum;
+    qDebug();
+    qDebug() << "Add-ons \"" << QFileInfo(filePath).absoluteFilePath() << "\" is created";
+
+}
+
+/* repack the add-on each time the source folder settles after a change */
+int watchFolder(QString sourceFolder,
+                QString modelName,
+                int i3rdParty,
+                int debounce) {
+
+    QDir destFolder(sourceFolder);
+    if(!destFolder.cdUp()) {
+        qDebug() << "Can not use upper of source folder to destination folder.";
+        return 1;
+    }
+
+    QString rcPath = sourceFolder + "/apkg.rc";
+    if(!QFileInfo(rcPath).exists()) {
+        qDebug() << "Source folder is invalid.";
+        return 1;
+    }
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd < 0) {
+        qDebug() << "Can not watch source folder.";
+        return 1;
+    }
+
+    const uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                          IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                          IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+    /* inotify is not recursive, every sub folder gets its own watch */
+    QHash<int, QString> watches;
+    std::function<void(const QString &)> addWatches = [&](const QString &path) {
+        int wd = inotify_add_watch(fd, QFile::encodeName(path).constData(), mask);
+        if(wd < 0)
+            return;
+        watches.insert(wd, path);
+
+        QStringList list = QDir(path).entryList(QDir::Dirs | QDir::Hidden |
+                                                QDir::NoDotAndDotDot | QDir::NoSymLinks);
+        for(const QString &e : list)
+            addWatches(path + "/" + e);
+    };
+    addWatches(sourceFolder);
+
+    ApkgArchive archive(QDir(sourceFolder), true);
+    QString lastFilePath;
+    bool failed = false;    // the scanned state is not in a package yet
+
+    auto repack = [&]() {
+        QElapsedTimer elapsed;
+        elapsed.start();
+
+        if(!QFileInfo(rcPath).exists()) {
+            qDebug() << "Source folder is invalid.";
+            return;
+        }
+
+        QMap<QString, QString> map = getRC(rcPath);
+        if(!isPackageValid(QDir(sourceFolder), destFolder, map, modelName))
+            return;
+
+        int changed = archive.scan();
+        QString filePath = packageFilePath(destFolder, map, modelName);
+        if(changed == 0 && !failed && filePath == lastFilePath && QFileInfo(filePath).exists())
+            return;
+
+        QByteArray checkSum;
+        failed = !writePackage(filePath, packageHeader(map, modelName, i3rdParty), archive, checkSum);
+        if(failed)
+            return;
+
+        /* do not leave packages of a stale name or date behind */
+        if(!lastFilePath.isEmpty() && lastFilePath != filePath)
+            QFile::remove(lastFilePath);
+        lastFilePath = filePath;
+
+        qDebug() << "Add-ons \"" << QFileInfo(filePath).absoluteFilePath() << "\" is updated"
+                 << "(" << changed << "of" << archive.entryCount() << "entries,"
+                 << elapsed.elapsed() << "ms, checksum" << checkSum << ")";
+    };
+
+    QTimer timer;
+    timer.setSingleShot(true);
+    timer.setInterval(debounce);
+    QObject::connect(&timer, &QTimer::timeout, repack);
+
+    QSocketNotifier notifier(fd, QSocketNotifier::Read);
+    QObject::connect(&notifier, &QSocketNotifier::activated, [&]() {
+        char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while((len = ::read(fd, buf, sizeof(buf))) > 0) {
+            for(char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+                const struct inotify_event *event = (const struct inotify_event *)p;
+                /* events were dropped, folders made meanwhile may lack a watch */
+                if(event->mask & IN_Q_OVERFLOW) {
+                    watches.clear();
+                    addWatches(sourceFolder);
+                }
+                else if(event->mask & IN_IGNORED)
+                    watches.remove(event->wd);
+                else if((event->mask & IN_ISDIR) &&
+                        (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                        watches.contains(event->wd))
+                    addWatches(watches.value(event->wd) + "/" + QFile::decodeName(event->name));
+            }
+        }
+        timer.start();
+    });
+
+    qDebug();
+    qDebug() << "============================================";
+    qDebug() << "	 mkapkg version: " << QCoreApplication::applicationVersion();
+    qDebug() << "============================================";
+    qDebug();
+    qDebug() << "Watching " << sourceFolder << ", press Ctrl+C to stop.";
+
+    repack();
+    int ret = QCoreApplication::exec();
+    ::close(fd);
+    return ret;
+}
+
+/* check the limitation of package header fields */
+bool isPackageValid(QDir sourceFolder,
+                    QDir destFolder,
+                    QMap<QString, QString> &map,
+                    QString modelName) {
+
 //    if(!sourceFolder.endsWith("/"))
 //        sourceFolder += "/";
 //    if(!destFolder.endsWith("/"))
@@ -164,67 +467,48 @@ void packageFile(QDir sourceFolder,
 
     if(!sourceFolder.exists()) {
         qDebug() << "Source folder is invalid.";
-        return;
+        return false;
     }
 
     if(!destFolder.exists()) {
         qDebug() << "Destination folder is invalid.";
-        return;
+        return false;
     }
 
     if(sourceFolder.absolutePath().compare(destFolder.absolutePath()) == 0) {
 //        qDebug() << sourceFolder.absolutePath();
 //        qDebug() << destFolder.absolutePath();
         qDebug() << "Source directory can not be equel to destination directory";
-        return;
+        return false;
     }
 
     if(modelName.size() > 10) {
         qDebug() << "The length limitation of model name is 10";
         qDebug() << "Length of model name(" << modelName << ") is too long.";
-        return;
+        return false;
     }
 
     if(map.value("Package").size() > 66) {
         qDebug() << "The length limitation of package name is 66";
         qDebug() << "Length of package name(" << map.value("Package") << ") is too long.";
-        return;
+        return false;
     }
 
     if(map.value("Version").size() > 10) {
         qDebug() << "The length limitation of version is 66";
         qDebug() << "Length of version(" << map.value("Version") << ") is too long.";
-        return;
+        return false;
     }
 
-    QString filePath = destFolder.absolutePath() + "/" + PACKAGE_TEMP_FILE;
-
-    qDebug();
-    qDebug() << "============================================";
-    qDebug() << "	 mkapkg version: " << QCoreApplication::applicationVersion();
-    qDebug() << "============================================";
-    qDebug();
+    return true;
+}
 
-    QProcess process;
-    QStringList list = QStringList()
-             << "zcvf"
-             << filePath
-             << "-C" << destFolder.absolutePath()
-             << sourceFolder.dirName();
-    //qDebug() << list;
-    process.setProcessChannelMode(QProcess::ForwardedChannels);
-    process.start("tar", list);
-    process.waitForFinished();
-
-    QFile tgzFile(filePath);
-    if(!tgzFile.exists()) {
-        qDebug() << "File: " << filePath << " dose not exist.";
-        return;
-    }
+/* 200 bytes package header, checksum at 0xA8 is filled in later */
+QByteArray packageHeader(QMap<QString, QString> &map,
+                         QString modelName,
+                         int i3rdParty) {
 
     int headerSize = 200;
-    tgzFile.open(QIODevice::ReadOnly);
-    QDataStream in(&tgzFile);    // read the data serialized from the file
     QByteArray str(headerSize, 0);
     str.replace(0x00, modelName.size(), modelName.toLocal8Bit());
     QByteArray packageName(map.value("Package").toLocal8Bit());
@@ -242,53 +526,54 @@ void packageFile(QDir sourceFolder,
         devValue = QByteArray::fromHex("01");
     str.replace(0x80/*128*/, 1, devValue);
 
+    return str;
+}
+
+QString packageFilePath(QDir destFolder,
+                        QMap<QString, QString> &map,
+                        QString modelName) {
+
     QString outFileName("%1 %2 Package v%3_%4");
-    QFile outFile(destFolder.absolutePath() + "/" +
-                  outFileName
-                  .arg(modelName)
-                  .arg(map.value("Package"))
-                  .arg(map.value("Version"))
-                  .arg(QDateTime::currentDateTime().toString("MMddyyyy")));
-    if(outFile.exists())
-        outFile.remove();
+    return destFolder.absolutePath() + "/" +
+            outFileName
+            .arg(modelName)
+            .arg(map.value("Package"))
+            .arg(map.value("Version"))
+            .arg(QDateTime::currentDateTime().toString("MMddyyyy"));
+}
 
-    outFile.open(QIODevice::WriteOnly);
-    if(!outFile.isWritable()) {
+/* write header and archive to filePath, the old file is replaced atomically */
+bool writePackage(QString filePath,
+                  QByteArray str,
+                  const ApkgArchive &archive,
+                  QByteArray &checkSum) {
+
+    QSaveFile outFile(filePath);
+    if(!outFile.open(QIODevice::WriteOnly)) {
         qDebug() << "File: " << filePath << " could not be written.";
-        outFile.close();
-        return;
+        return false;
     }
 
-    outFile.seek(200);
+    outFile.write(QByteArray(200, 0));
 
-    int bufSize = 4096;
     QCryptographicHash hash(QCryptographicHash::Md5);
-    while(!in.atEnd()) {
-        QByteArray buf = tgzFile.read(bufSize);
-        hash.addData(buf);
-        outFile.write(buf);
+    if(!archive.write(outFile, hash)) {
+        qDebug() << "File: " << filePath << " could not be written.";
+        outFile.cancelWriting();
+        return false;
     }
 
     outFile.reset();
-    QByteArray checkSum(hash.result().toHex());
+    checkSum = hash.result().toHex();
     str.replace(0xA8/*168*/, checkSum.size(), checkSum);
 
     outFile.write(str);
 
-    tgzFile.close();
-    outFile.close();
-    tgzFile.remove();
-
-    qDebug();
-    qDebug() << "Model name:		" << modelName;
-    qDebug() << "Package name:		" << map.value("Package");
-    qDebug() << "Package version:	" << map.value("Version");
-    qDebug() << "Packager:	        " << map.value("Packager");
-    qDebug();
-    qDebug() << "Package checksum:	" << checkSum;
-    qDebug();
-    qDebug() << "Add-ons \"" << QFileInfo(outFile).absoluteFilePath() << "\" is created";
-
+    if(!outFile.commit()) {
+        qDebug() << "File: " << filePath << " could not be written.";
+        return false;
+    }
+    return true;
 }
 
 
@@ -354,6 +639,130 @@ void unpackageFile(QString sourceFile) {
 
 }
 
+/* check many add-ons at once, their payloads are hashed side by side */
+int verifyFiles(QStringList sourceFiles) {
+    QStringList paths;
+    QList<QByteArray> headerChkSums;
+    int errors = 0;
+
+    for(const QString &sourceFile : sourceFiles) {
+        QFile file(sourceFile);
+        if(!file.open(QIODevice::ReadOnly)) {
+            qDebug() << "File: " << sourceFile << " dose not exist.";
+            errors++;
+            continue;
+        }
+
+        file.seek(0xA8);
+        QByteArray headerChkSum = file.read(32);
+        file.close();
+
+        if(headerChkSum.isEmpty()) {
+            qDebug() << "File: " << sourceFile << " is invalid";
+            errors++;
+            continue;
+        }
+        paths << sourceFile;
+        headerChkSums << headerChkSum;
+    }
+
+    QList<QByteArray> result = MultiMd5::hashFiles(paths, 200);
+
+    for(int i = 0; i < paths.size(); i++) {
+        if(result.at(i).isEmpty() || result.at(i).toHex() != headerChkSums.at(i)) {
+            qDebug() << "File: " << QFileInfo(paths.at(i)).absoluteFilePath() << " - checksum is error.";
+            errors++;
+        }
+        else
+            qDebug() << "File: " << QFileInfo(paths.at(i)).absoluteFilePath() << " - checksum is ok.";
+    }
+
+    qDebug();
+    qDebug() << sourceFiles.size() - errors << " of " << sourceFiles.size() << " files are ok"
+             << "(md5: " << MultiMd5::engine() << ")";
+
+    return errors ? 1 : 0;
+}
+
+/* catalog fields of an add-on header, see Catalog::update() */
+bool readCatalogHeader(const QString &sourceFile, CatalogRecord &record) {
+    QFile file(sourceFile);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray str = file.read(200);
+    file.close();
+
+    QByteArray checkSum = str.mid(0xA8, 32);
+    if(!Catalog::isChecksum(checkSum))
+        return false;
+
+    /*
+     * firmware images have the same header, tell them apart by the fields
+     * only a package fills in: package name, short version, 3rd party flag
+     */
+    QByteArray package = str.mid(0x0A, 0x4C - 0x0A).constData();
+    QByteArray version = str.mid(0x4C, 0x80 - 0x4C).constData();
+    if(package.isEmpty() || version.isEmpty() || version.size() > 10)
+        return false;
+    if(str.at(0x80) != 0 && str.at(0x80) != 1)
+        return false;
+
+    record.model = QString::fromLocal8Bit(str.mid(0x00, 0x0A).constData());
+    record.package = QString::fromLocal8Bit(package);
+    record.version = QString::fromLocal8Bit(version);
+    record.checksum = checkSum;
+
+    /* the build date is only kept in the file name, "... v<version>_MMddyyyy" */
+    record.buildDate = QDate::fromString(QFileInfo(sourceFile).fileName().section('_', -1), "MMddyyyy");
+    return true;
+}
+
+int indexFolder(QString folder, QString catalogFile) {
+    if(!QDir(folder).exists()) {
+        qDebug() << "Source folder is invalid.";
+        return 1;
+    }
+
+    int rescanned = 0;
+    if(!Catalog::update(folder, catalogFile, readCatalogHeader, rescanned)) {
+        qDebug() << "File: " << catalogFile << " could not be written.";
+        return 1;
+    }
+
+    Catalog catalog;
+    catalog.open(catalogFile);
+    qDebug() << "Catalog " << QFileInfo(catalogFile).absoluteFilePath() << " is updated"
+             << "(" << catalog.find(QString(), QString(), QString()).size() << "add-ons in"
+             << catalog.count() << "files," << rescanned << "rescanned )";
+    return 0;
+}
+
+int queryCatalog(QString folder, QString catalogFile,
+                 QString modelName, QString packageName, QString version) {
+    Catalog catalog;
+    if(!catalog.open(catalogFile)) {
+        qDebug() << "File: " << catalogFile << " is invalid, please run mkapkg index first.";
+        return 1;
+    }
+
+    QList<int> list = catalog.find(modelName, packageName, version);
+    for(int i : list) {
+        CatalogRecord record = catalog.at(i);
+        qDebug() << qPrintable(QString("%1  %2  %3  %4  %5  %6")
+                               .arg(record.model, -10)
+                               .arg(record.package, -20)
+                               .arg(record.version, -10)
+                               .arg(record.buildDate.toString("yyyy/MM/dd"), -10)
+                               .arg(QString(record.checksum))
+                               .arg(QDir(folder).filePath(record.path)));
+    }
+
+    qDebug();
+    qDebug() << list.size() << " add-ons are found.";
+    return 0;
+}
+
 
 QMap<QString, QString> getRC(QString filePath) {
     QMap<QString, QString> ret;
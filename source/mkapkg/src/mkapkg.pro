@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core
+QT       += core concurrent
 
 QT       -= gui
 
@@ -16,4 +16,15 @@ TEMPLATE = app
 
 #QMAKE_RPATHDIR += lib
 
-SOURCES += main.cpp
+INCLUDEPATH += ../../common
+
+SOURCES += main.cpp \
+    apkgarchive.cpp \
+    ../../common/catalog.cpp
+
+HEADERS += apkgarchive.h \
+    ../../common/catalog.h
+
+include(../../common/md5mb.pri)
+
+LIBS += -lz
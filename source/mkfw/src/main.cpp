@@ -9,9 +9,18 @@
 #include <QCryptographicHash>
 #include <QDataStream>
 
+#include "md5mb.h"
+#include "catalog.h"
+
+const QString CATALOG_FILE = ".mkfw.catalog";
+
 void packageFile(QFile &, QDir &, QString, QString);
 void unpackageFile(QString);
 void showInfo(QString);
+int verifyFiles(QStringList);
+int indexFolder(QString, QString);
+int queryCatalog(QString, QString, QString, QString);
+bool readCatalogHeader(const QString &, CatalogRecord &);
 
 class Header {
 public:
@@ -52,6 +61,77 @@ int main(int argc, char *argv[])
         else
             qDebug() << "You must select a source file.";
     }
+    else if (command == "verify") {
+        parser.setApplicationDescription("mkfw helper\n\n"
+                                         "ex. mkfw verify <file> [<file> ...]");
+
+        parser.addHelpOption();
+        parser.addPositionalArgument("verify", "verify checksum of your firmwares.", "verify <file> [<file> ...]");
+
+        parser.process(app);
+
+        QStringList files = parser.positionalArguments().mid(1);
+        if(!files.isEmpty())
+            return verifyFiles(files);
+        else
+            qDebug() << "You must select a source file.";
+    }
+    else if (command == "index") {
+        parser.setApplicationDescription("mkfw helper\n\n"
+                                         "ex. mkfw index <folder>\n"
+                                         "(Catalog the firmware headers below folder for mkfw query.)");
+
+        parser.addHelpOption();
+        parser.addPositionalArgument("index", "index your firmwares.", "index <folder> [index_options]");
+
+        QCommandLineOption catalogOption(QStringList() << "c" << "catalog",
+                                           "Select a catalog file <catalog file>.",
+                                           "catalog file");
+        parser.addOption(catalogOption);
+
+        parser.process(app);
+
+        QString folder = parser.positionalArguments().value(1, QDir::currentPath());
+        QString catalogFile = parser.value(catalogOption);
+        if(catalogFile.isEmpty())
+            catalogFile = QDir(folder).filePath(CATALOG_FILE);
+
+        return indexFolder(folder, catalogFile);
+    }
+    else if (command == "query") {
+        parser.setApplicationDescription("mkfw helper\n\n"
+                                         "ex. mkfw query <folder> -m <model> -n <version>\n"
+                                         "(Search the catalog made by mkfw index.)");
+
+        parser.addHelpOption();
+        parser.addPositionalArgument("query", "query your firmwares.", "query <folder> [query_options]");
+
+        QCommandLineOption modelNameOption(QStringList() << "m" << "model-name",
+                                           "Select a model name <model name>.",
+                                           "model name");
+        parser.addOption(modelNameOption);
+
+        QCommandLineOption newerOption(QStringList() << "n" << "newer-than",
+                                           "Select firmwares newer than <fw version>.",
+                                           "firmware version");
+        parser.addOption(newerOption);
+
+        QCommandLineOption catalogOption(QStringList() << "c" << "catalog",
+                                           "Select a catalog file <catalog file>.",
+                                           "catalog file");
+        parser.addOption(catalogOption);
+
+        parser.process(app);
+
+        QString folder = parser.positionalArguments().value(1, QDir::currentPath());
+        QString catalogFile = parser.value(catalogOption);
+        if(catalogFile.isEmpty())
+            catalogFile = QDir(folder).filePath(CATALOG_FILE);
+
+        return queryCatalog(folder, catalogFile,
+                            parser.value(modelNameOption),
+                            parser.value(newerOption));
+    }
     else {
         //QStringList supportList = getSupportModels();
 
@@ -60,7 +140,12 @@ int main(int argc, char *argv[])
                                          "ex. mkfw -m <model> -v [version] -s <file>\n"
                                          "(If destination is not selected, mkfw will use current directory for destination.)\n\n"
                                          "For unpack help:\n"
-                                         "mkfw unpack --help");
+                                         "mkfw unpack --help\n"
+                                         "For verify help:\n"
+                                         "mkfw verify --help\n"
+                                         "For index and query help:\n"
+                                         "mkfw index --help\n"
+                                         "mkfw query --help");
         parser.addHelpOption();
 
         QCommandLineOption modelNameOption(QStringList() << "m" << "model-name",
@@ -313,3 +398,110 @@ void showInfo(QString sourceFile) {
              << "\n";
 
 }
+
+/* check many firmwares at once, their payloads are hashed side by side */
+int verifyFiles(QStringList sourceFiles) {
+    QStringList paths;
+    QList<Header> headers;
+    int errors = 0;
+
+    for(const QString &sourceFile : sourceFiles) {
+        Header header;
+        if(!isValidFile(sourceFile, header)) {
+            errors++;
+            continue;
+        }
+        paths << sourceFile;
+        headers << header;
+    }
+
+    QList<QByteArray> result = MultiMd5::hashFiles(paths, 200);
+
+    for(int i = 0; i < paths.size(); i++) {
+        QString checkSum(result.at(i).toHex());
+        if(result.at(i).isEmpty() || checkSum != headers.at(i).checksum) {
+            qDebug() << "File: " << QFileInfo(paths.at(i)).absoluteFilePath() << " - checksum is error.";
+            errors++;
+        }
+        else
+            qDebug() << "File: " << QFileInfo(paths.at(i)).absoluteFilePath() << " - checksum is ok.";
+    }
+
+    qDebug() << "\n"
+             << sourceFiles.size() - errors << " of " << sourceFiles.size() << " files are ok"
+             << "(md5: " << MultiMd5::engine() << ")";
+
+    return errors ? 1 : 0;
+}
+
+/* catalog fields of a firmware header, see Catalog::update() */
+bool readCatalogHeader(const QString &sourceFile, CatalogRecord &record) {
+    QFile file(sourceFile);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QByteArray str = file.read(200);
+    file.close();
+
+    QByteArray checkSum = str.mid(0xA8, 32);
+    if(!Catalog::isChecksum(checkSum))
+        return false;
+
+    /*
+     * version in header is <version>.MMdd.yyyy, add-on packages have the
+     * same header with a plain version and are not firmware images
+     */
+    QString versionInHeader = QString::fromLocal8Bit(str.mid(0x4C, 0xA8 - 0x4C).constData());
+    QString version = versionInHeader.section('.', 0, -3);
+    QDate buildDate = QDate::fromString(versionInHeader.section('.', -2), "MMdd.yyyy");
+    if(version.isEmpty() || !buildDate.isValid())
+        return false;
+
+    record.model = QString::fromLocal8Bit(str.mid(0x00, 0x4C).constData());
+    record.version = version;
+    record.buildDate = buildDate;
+    record.checksum = checkSum;
+    return true;
+}
+
+int indexFolder(QString folder, QString catalogFile) {
+    if(!QDir(folder).exists()) {
+        qDebug() << "Source folder is invalid.";
+        return 1;
+    }
+
+    int rescanned = 0;
+    if(!Catalog::update(folder, catalogFile, readCatalogHeader, rescanned)) {
+        qDebug() << "File: " << catalogFile << " could not be written.";
+        return 1;
+    }
+
+    Catalog catalog;
+    catalog.open(catalogFile);
+    qDebug() << "Catalog " << QFileInfo(catalogFile).absoluteFilePath() << " is updated"
+             << "(" << catalog.find(QString(), QString(), QString()).size() << "firmwares in"
+             << catalog.count() << "files," << rescanned << "rescanned )";
+    return 0;
+}
+
+int queryCatalog(QString folder, QString catalogFile, QString modelName, QString version) {
+    Catalog catalog;
+    if(!catalog.open(catalogFile)) {
+        qDebug() << "File: " << catalogFile << " is invalid, please run mkfw index first.";
+        return 1;
+    }
+
+    QList<int> list = catalog.find(modelName, QString(), version);
+    for(int i : list) {
+        CatalogRecord record = catalog.at(i);
+        qDebug() << qPrintable(QString("%1  %2  %3  %4  %5")
+                               .arg(record.model, -12)
+                               .arg(record.version, -10)
+                               .arg(record.buildDate.toString("yyyy/MM/dd"), -10)
+                               .arg(QString(record.checksum))
+                               .arg(QDir(folder).filePath(record.path)));
+    }
+
+    qDebug() << "\n" << list.size() << " firmwares are found.";
+    return 0;
+}
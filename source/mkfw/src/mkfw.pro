@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core
+QT       += core concurrent
 
 QT       -= gui
 
@@ -14,4 +14,11 @@ CONFIG   -= app_bundle
 
 TEMPLATE = app
 
-SOURCES += main.cpp
+INCLUDEPATH += ../../common
+
+SOURCES += main.cpp \
+    ../../common/catalog.cpp
+
+HEADERS += ../../common/catalog.h
+
+include(../../common/md5mb.pri)